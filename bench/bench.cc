@@ -0,0 +1,97 @@
+#include "taskit.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+template<int V>
+struct Add
+{
+    int operator()(int acc) const
+    {
+        return acc + V;
+    }
+};
+
+// Keys are declared alphabetically, but the most frequent ones come last so the plain chain
+// walks almost every comparison for the hot messages.
+struct Zipf
+{
+    static constexpr const char* name = "zipf  ";
+    static constexpr std::size_t weight(std::size_t i) { return 1000 / ( 16 - i ); }
+};
+
+struct Skewed
+{
+    static constexpr const char* name = "skewed";
+    static constexpr std::size_t weight(std::size_t i) { return i == 15 ? 900 : 1000 / ( 16 - i ) / 10 + 1; }
+};
+
+template<char K>
+constexpr auto plainTask()
+{
+    return taskit::make_TaskType<char, K, Add<K>>();
+}
+
+template<class Profile, char K>
+constexpr auto weightedTask()
+{
+    return taskit::make_WeightedTaskType<Profile::weight( K - 'a' )>( plainTask<K>() );
+}
+
+template<std::size_t... I>
+auto make_plain(std::index_sequence<I...>)
+{
+    return taskit::make_Tasks<char>( plainTask<'a' + I>()..., taskit::make_TaskType<char, '0', Add<0>>() );
+}
+
+template<class Profile, std::size_t... I>
+auto make_weighted(std::index_sequence<I...>)
+{
+    return taskit::make_WeightedTasks<char>( weightedTask<Profile, 'a' + I>()..., taskit::make_TaskType<char, '0', Add<0>>() );
+}
+
+template<class Tasks>
+void run(const std::string& name, Tasks tasks, const std::vector<char>& keys)
+{
+    int acc = 0;
+    auto start = std::chrono::steady_clock::now();
+    for( auto key : keys )
+    {
+        acc = tasks.select( key )( acc );
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start );
+
+    std::cout << name << ": " << static_cast<double>( elapsed.count() ) / keys.size() << " ns/dispatch"
+              << " (checksum " << acc << ")" << std::endl;
+}
+
+template<class Profile>
+void compare(std::size_t messages)
+{
+    std::vector<double> weights;
+    for( std::size_t i = 0; i < 16; ++i ) weights.push_back( Profile::weight( i ) );
+
+    std::mt19937 gen( 42 );
+    std::discrete_distribution<int> dist( weights.begin(), weights.end() );
+
+    std::vector<char> keys( messages );
+    for( auto& key : keys ) key = static_cast<char>( 'a' + dist( gen ) );
+
+    auto tasks = std::make_index_sequence<16>();
+    run( std::string( Profile::name ) + " plain chain  ", make_plain( tasks ), keys );
+    run( std::string( Profile::name ) + " weighted tree", make_weighted<Profile>( tasks ), keys );
+}
+
+int main(int argc, char* argv[])
+{
+    const std::size_t messages = argc > 1 ? std::stoul( argv[1] ) : 50000000;
+
+    compare<Zipf>( messages );
+    compare<Skewed>( messages );
+
+    return 0;
+}
@@ -5,6 +5,8 @@
 
 #include "taskit_sequence.hpp"
 #include "taskit_selector.hpp"
+#include "taskit_dispatcher.hpp"
+#include "taskit_hotswap.hpp"
 
 #else
 #error "C++14 compliant compiler is needed"
@@ -0,0 +1,85 @@
+#ifndef __TASKIT_DEADLINE_H__
+#define __TASKIT_DEADLINE_H__
+
+#include <chrono>
+#include <cstdint>
+
+#if defined(_MSC_VER) && ( defined(_M_X64) || defined(_M_IX86) )
+#include <intrin.h>
+#define TASKIT_HAS_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TASKIT_HAS_TSC
+#endif
+
+namespace taskit {
+
+// Raw cycle counter. Budgets are expressed in ticks, so no calibration is paid on the hot path.
+// Falls back to steady_clock ticks where no time stamp counter is available.
+struct CycleClock
+{
+    using rep = std::uint64_t;
+    using duration = rep;
+    using time_point = rep;
+
+    static time_point now() noexcept
+    {
+#ifdef TASKIT_HAS_TSC
+        return __rdtsc();
+#else
+        return static_cast<time_point>( std::chrono::steady_clock::now().time_since_epoch().count() );
+#endif
+    }
+};
+
+// Per-run budget. The clock is only read once every CheckEvery queries and, once exhausted,
+// the deadline sticks to expired without reading the clock any more.
+template<class Clock = std::chrono::steady_clock, unsigned CheckEvery = 1>
+class Deadline
+{
+    static_assert( CheckEvery > 0, "CheckEvery must be greater than zero" );
+
+public:
+
+    using clock = Clock;
+    using time_point = decltype( Clock::now() );
+
+    template<typename Budget>
+    explicit Deadline(Budget budget)
+        : end_( Clock::now() + budget )
+    {}
+
+    static Deadline at(time_point end)
+    {
+        return Deadline( end, 0 );
+    }
+
+    bool expired() noexcept
+    {
+        if( expired_ ) return true;
+        if( --countdown_ ) return false;
+        countdown_ = CheckEvery;
+        expired_ = !( Clock::now() < end_ );
+        return expired_;
+    }
+
+private:
+
+    Deadline(time_point end, int)
+        : end_( end )
+    {}
+
+    time_point end_;
+    unsigned countdown_ = 1;
+    bool expired_ = false;
+};
+
+template<class Clock = std::chrono::steady_clock, unsigned CheckEvery = 1, typename Budget>
+auto make_Deadline(Budget budget)
+{
+    return Deadline<Clock, CheckEvery>( budget );
+}
+
+} // taskit namespace
+
+#endif // __TASKIT_DEADLINE_H__
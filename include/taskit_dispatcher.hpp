@@ -0,0 +1,441 @@
+#ifndef __TASKIT_DISPATCHER_H__
+#define __TASKIT_DISPATCHER_H__
+
+#include "taskit_selector.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace taskit {
+
+// Over-aligned heap allocations are only honoured since C++17
+#if defined(__cpp_aligned_new) && __cpp_aligned_new >= 201606L
+#define TASKIT_CACHE_ALIGNED alignas(::taskit::cacheLineSize)
+#else
+#define TASKIT_CACHE_ALIGNED
+#endif
+
+// Bounded multi-producer single-consumer ring (D. Vyukov). Cells are allocated once, so no memory
+// is allocated on one thread and released on another while messages flow. Producers only contend
+// on a single compare-exchange, the consumer never writes shared state but the cell it releases.
+template<typename T>
+class MpscQueue
+{
+    struct Cell
+    {
+        std::atomic<std::size_t> sequence;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+        T& value() noexcept { return *reinterpret_cast<T*>( &storage ); }
+    };
+
+    static std::size_t roundUp(std::size_t capacity) noexcept
+    {
+        std::size_t size = 2;
+        while( size < capacity ) size *= 2;
+        return size;
+    }
+
+public:
+
+    // Capacity is rounded up to a power of two
+    explicit MpscQueue(std::size_t capacity)
+        : mask_( roundUp( capacity ) - 1 )
+        , cells_( new Cell[ mask_ + 1 ] )
+    {
+        for( std::size_t i = 0; i <= mask_; ++i ) cells_[i].sequence.store( i, std::memory_order_relaxed );
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    ~MpscQueue()
+    {
+        for( ;; )
+        {
+            auto& cell = cells_[ tail_ & mask_ ];
+            if( cell.sequence.load( std::memory_order_acquire ) != tail_ + 1 ) break;
+            cell.value().~T();
+            ++tail_;
+        }
+    }
+
+    // Returns false, leaving value untouched, when the queue is full
+    bool tryPush(T& value)
+    {
+        auto pos = head_.load( std::memory_order_relaxed );
+        for( ;; )
+        {
+            auto& cell = cells_[ pos & mask_ ];
+            const auto seq = cell.sequence.load( std::memory_order_acquire );
+            const auto diff = static_cast<std::intptr_t>( seq ) - static_cast<std::intptr_t>( pos );
+            if( diff == 0 )
+            {
+                if( head_.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+                {
+                    new ( &cell.storage ) T( std::move( value ) );
+                    cell.sequence.store( pos + 1, std::memory_order_release );
+                    return true;
+                }
+            }
+            else if( diff < 0 )
+            {
+                return false;
+            }
+            else
+            {
+                pos = head_.load( std::memory_order_relaxed );
+            }
+        }
+    }
+
+    // Hands the oldest value over to consume in place, so T only needs to be move constructible.
+    // Returns false when empty or when a producer has not completed its push yet.
+    template<class Consumer>
+    bool pop(Consumer&& consume)
+    {
+        auto& cell = cells_[ tail_ & mask_ ];
+        if( cell.sequence.load( std::memory_order_acquire ) != tail_ + 1 ) return false;
+
+        consume( cell.value() );
+        cell.value().~T();
+        cell.sequence.store( tail_ + mask_ + 1, std::memory_order_release );
+        ++tail_;
+        return true;
+    }
+
+    // Consumer side only. Sequentially consistent, so it can be paired with a fence by producers.
+    bool empty() const
+    {
+        return cells_[ tail_ & mask_ ].sequence.load( std::memory_order_seq_cst ) != tail_ + 1;
+    }
+
+private:
+
+    const std::size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    TASKIT_CACHE_ALIGNED std::atomic<std::size_t> head_{ 0 };
+    TASKIT_CACHE_ALIGNED std::size_t tail_ = 0;
+};
+
+// What an idle worker does once it has polled its empty queue for a while: park until a message
+// is dispatched to it, or keep spinning (yielding) for the lowest wake up latency at the cost of
+// a busy core.
+enum class ShardIdle
+{
+    park,
+    spin
+};
+
+struct ShardStats
+{
+    std::uint64_t enqueued;
+    std::uint64_t processed;
+};
+
+// Routes every message to the worker thread owning its key, so each core only runs (and keeps warm)
+// the handlers and handler state of its own keys. Keys are hashed into buckets and buckets are
+// assigned to shards; rebalance() moves hot buckets away from overloaded shards. Messages of the
+// same key keep their order unless their bucket is moved while they are in flight.
+// Queues are bounded: dispatch() waits while the target queue is full, so handlers must not
+// dispatch themselves.
+template<class Tasks, typename Message, class KeyOf, class BucketOf>
+class ShardedDispatcher
+{
+    using key_t = std::decay_t<decltype( std::declval<KeyOf&>()( std::declval<const Message&>() ) )>;
+
+    // Empty polls before an idle worker yields or parks
+    static constexpr unsigned spinLimit = 1024;
+
+    struct Item
+    {
+        Message msg;
+        key_t key;
+        std::size_t bucket;
+    };
+
+    struct TASKIT_CACHE_ALIGNED Shard
+    {
+        Shard(const Tasks& tasks, std::size_t capacity) : queue_( capacity ), tasks_( tasks ) {}
+
+        MpscQueue<Item> queue_;
+        TASKIT_CACHE_ALIGNED std::atomic<std::uint64_t> enqueued_{ 0 };
+        TASKIT_CACHE_ALIGNED std::atomic<std::uint64_t> processed_{ 0 };
+        TASKIT_CACHE_ALIGNED std::atomic<bool> parked_{ false };
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        Tasks tasks_;
+        std::thread thread_;
+    };
+
+    struct TASKIT_CACHE_ALIGNED Bucket
+    {
+        std::atomic<std::size_t> shard{ 0 };
+        std::atomic<std::uint64_t> load{ 0 };
+        std::uint64_t lastLoad = 0;
+    };
+
+public:
+
+    // Throws std::system_error when a worker cannot be pinned to its cpu
+    ShardedDispatcher(const Tasks& tasks, KeyOf keyOf, BucketOf bucketOf, std::size_t shards, std::size_t buckets,
+                      std::vector<int> cpus, ShardIdle idle, std::size_t capacity)
+        : keyOf_( std::move( keyOf ) )
+        , bucketOf_( std::move( bucketOf ) )
+        , buckets_( buckets ? buckets : 1 )
+        , idle_( idle )
+    {
+        shards = shards ? shards : 1;
+        for( std::size_t i = 0; i < buckets_.size(); ++i )
+        {
+            buckets_[i].shard.store( i % shards, std::memory_order_relaxed );
+        }
+
+        for( std::size_t i = 0; i < shards; ++i )
+        {
+            shards_.emplace_back( new Shard( tasks, capacity ) );
+        }
+        for( std::size_t i = 0; i < shards; ++i )
+        {
+            auto& shard = *shards_[i];
+            shard.thread_ = std::thread( [this, &shard] { work( shard ); } );
+        }
+
+        const auto error = pin( cpus );
+        if( error )
+        {
+            stop();
+            throw std::system_error( error, "cannot pin dispatcher worker" );
+        }
+    }
+
+    ShardedDispatcher(const ShardedDispatcher&) = delete;
+    ShardedDispatcher& operator=(const ShardedDispatcher&) = delete;
+
+    ~ShardedDispatcher()
+    {
+        stop();
+    }
+
+    // Returns false, dropping the message, once stop() has been called
+    bool dispatch(Message msg)
+    {
+        auto key = keyOf_( msg );
+        const auto bucket = bucketOf_( key ) % buckets_.size();
+        auto& shard = *shards_[ buckets_[bucket].shard.load( std::memory_order_acquire ) ];
+
+        // Either the stopping worker sees this message accounted for and waits for it, or it is
+        // rejected here
+        shard.enqueued_.fetch_add( 1, std::memory_order_seq_cst );
+        if( TASKIT_EXPECT( stopping_.load( std::memory_order_seq_cst ), false ) )
+        {
+            shard.enqueued_.fetch_sub( 1, std::memory_order_release );
+            return false;
+        }
+
+        Item item{ std::move( msg ), std::move( key ), bucket };
+        while( !shard.queue_.tryPush( item ) )
+        {
+            wake( shard );
+            std::this_thread::yield();
+        }
+        wake( shard );
+        return true;
+    }
+
+    // Waits until every message dispatched so far has been processed
+    void wait() const
+    {
+        for( const auto& shard : shards_ )
+        {
+            while( shard->processed_.load( std::memory_order_acquire ) < shard->enqueued_.load( std::memory_order_acquire ) )
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // Processes pending messages and joins the workers. Messages dispatched afterwards are rejected.
+    void stop()
+    {
+        if( stopping_.exchange( true, std::memory_order_seq_cst ) ) return;
+        for( auto& shard : shards_ )
+        {
+            {
+                std::lock_guard<std::mutex> lock( shard->mutex_ );
+                shard->wake_.notify_one();
+            }
+            if( shard->thread_.joinable() ) shard->thread_.join();
+        }
+    }
+
+    std::size_t shards() const noexcept { return shards_.size(); }
+
+    std::size_t shardOf(const Message& msg) const
+    {
+        return buckets_[ bucketOf_( keyOf_( msg ) ) % buckets_.size() ].shard.load( std::memory_order_acquire );
+    }
+
+    ShardStats stats(std::size_t shard) const
+    {
+        return ShardStats{ shards_[shard]->enqueued_.load( std::memory_order_relaxed ),
+                           shards_[shard]->processed_.load( std::memory_order_relaxed ) };
+    }
+
+    // Moves hot buckets from the most to the least loaded shard, according to the load processed
+    // since the previous call, while the most loaded shard exceeds the mean by more than tolerance.
+    // A single hot key cannot be split, so skew within one bucket is left as is.
+    // Returns the number of buckets moved.
+    std::size_t rebalance(double tolerance = 1.25)
+    {
+        std::lock_guard<std::mutex> lock( rebalanceMutex_ );
+
+        std::vector<std::uint64_t> bucketLoad( buckets_.size() );
+        std::vector<std::uint64_t> shardLoad( shards_.size() );
+        std::uint64_t total = 0;
+        for( std::size_t i = 0; i < buckets_.size(); ++i )
+        {
+            const auto load = buckets_[i].load.load( std::memory_order_relaxed );
+            bucketLoad[i] = load - buckets_[i].lastLoad;
+            buckets_[i].lastLoad = load;
+            shardLoad[ buckets_[i].shard.load( std::memory_order_relaxed ) ] += bucketLoad[i];
+            total += bucketLoad[i];
+        }
+
+        const auto mean = static_cast<double>( total ) / shards_.size();
+        std::size_t moved = 0;
+        for( ;; )
+        {
+            const auto hottest = static_cast<std::size_t>( std::max_element( shardLoad.begin(), shardLoad.end() ) - shardLoad.begin() );
+            const auto coldest = static_cast<std::size_t>( std::min_element( shardLoad.begin(), shardLoad.end() ) - shardLoad.begin() );
+            if( static_cast<double>( shardLoad[hottest] ) <= mean * tolerance ) break;
+
+            // Pick the hottest bucket which still narrows the gap between both shards
+            const auto gap = shardLoad[hottest] - shardLoad[coldest];
+            std::size_t candidate = buckets_.size();
+            for( std::size_t i = 0; i < buckets_.size(); ++i )
+            {
+                if( buckets_[i].shard.load( std::memory_order_relaxed ) != hottest ) continue;
+                if( bucketLoad[i] == 0 || bucketLoad[i] >= gap ) continue;
+                if( candidate == buckets_.size() || bucketLoad[i] > bucketLoad[candidate] ) candidate = i;
+            }
+            if( candidate == buckets_.size() ) break;
+
+            buckets_[candidate].shard.store( coldest, std::memory_order_release );
+            shardLoad[hottest] -= bucketLoad[candidate];
+            shardLoad[coldest] += bucketLoad[candidate];
+            ++moved;
+        }
+        return moved;
+    }
+
+private:
+
+    void work(Shard& shard)
+    {
+        unsigned idle = 0;
+        const auto process = [this, &shard](Item& item)
+        {
+            shard.tasks_.select( item.key )( item.msg );
+            buckets_[item.bucket].load.fetch_add( 1, std::memory_order_relaxed );
+            shard.processed_.fetch_add( 1, std::memory_order_release );
+        };
+        for( ;; )
+        {
+            if( shard.queue_.pop( process ) )
+            {
+                idle = 0;
+            }
+            else if( stopping_.load( std::memory_order_seq_cst ) )
+            {
+                if( shard.processed_.load( std::memory_order_relaxed ) >= shard.enqueued_.load( std::memory_order_seq_cst ) ) return;
+                std::this_thread::yield();
+            }
+            else if( ++idle > spinLimit )
+            {
+                if( idle_ == ShardIdle::park ) park( shard );
+                else std::this_thread::yield();
+            }
+        }
+    }
+
+    // The flag is raised before the queue is checked again, and producers check the flag after
+    // pushing, so at least one of them sees the other
+    void park(Shard& shard)
+    {
+        std::unique_lock<std::mutex> lock( shard.mutex_ );
+        shard.parked_.store( true, std::memory_order_seq_cst );
+        shard.wake_.wait( lock, [this, &shard] { return !shard.queue_.empty() || stopping_.load( std::memory_order_seq_cst ); } );
+        shard.parked_.store( false, std::memory_order_relaxed );
+    }
+
+    static void wake(Shard& shard)
+    {
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        if( TASKIT_EXPECT( shard.parked_.load( std::memory_order_relaxed ), false ) )
+        {
+            std::lock_guard<std::mutex> lock( shard.mutex_ );
+            shard.wake_.notify_one();
+        }
+    }
+
+    // Pins worker i to cpus[i]. Workers without a cpu, or with a negative one, are left unpinned.
+    std::error_code pin(const std::vector<int>& cpus)
+    {
+#ifdef __linux__
+        for( std::size_t i = 0; i < cpus.size() && i < shards_.size(); ++i )
+        {
+            if( cpus[i] < 0 ) continue;
+            if( cpus[i] >= CPU_SETSIZE ) return std::make_error_code( std::errc::invalid_argument );
+            cpu_set_t set;
+            CPU_ZERO( &set );
+            CPU_SET( cpus[i], &set );
+            const auto error = pthread_setaffinity_np( shards_[i]->thread_.native_handle(), sizeof( set ), &set );
+            if( error ) return std::error_code( error, std::system_category() );
+        }
+#else
+        (void) cpus;
+#endif
+        return std::error_code();
+    }
+
+    KeyOf keyOf_;
+    BucketOf bucketOf_;
+    std::vector<Bucket> buckets_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    ShardIdle idle_;
+    std::atomic<bool> stopping_{ false };
+    std::mutex rebalanceMutex_;
+};
+
+// Workers are only pinned when given a cpu; negative cpus leave the corresponding worker unpinned.
+// Capacity is the number of messages each shard queue holds.
+template<typename Message, class Tasks, class KeyOf, class BucketOf = std::hash<std::decay_t<decltype( std::declval<KeyOf&>()( std::declval<const Message&>() ) )>>>
+auto make_ShardedDispatcher(const Tasks& tasks, KeyOf keyOf, std::size_t shards,
+                            std::size_t buckets = 0, BucketOf bucketOf = BucketOf(), std::vector<int> cpus = {},
+                            ShardIdle idle = ShardIdle::park, std::size_t capacity = 4096)
+{
+    return std::make_unique<ShardedDispatcher<Tasks, Message, KeyOf, BucketOf>>(
+        tasks, std::move( keyOf ), std::move( bucketOf ), shards, buckets ? buckets : 64 * shards, std::move( cpus ), idle, capacity );
+}
+
+} // taskit namespace
+
+#endif // __TASKIT_DISPATCHER_H__
@@ -0,0 +1,188 @@
+#ifndef __TASKIT_HOTSWAP_H__
+#define __TASKIT_HOTSWAP_H__
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace taskit {
+
+// Process wide epoch based reclamation. Readers publish the epoch they entered at in a per-thread
+// record (two stores, no shared writes, no loops) and writers wait until every reader which could
+// still see an old object has left before reclaiming it.
+class EpochDomain
+{
+    struct Record
+    {
+        std::atomic<std::uint64_t> epoch{ 0 };
+        std::atomic<bool> used{ true };
+        Record* next = nullptr;
+        unsigned depth = 0;
+    };
+
+    // Gives the record back to the domain when its thread exits
+    struct Registration
+    {
+        Record* record = nullptr;
+
+        ~Registration()
+        {
+            if( record ) record->used.store( false, std::memory_order_release );
+        }
+    };
+
+public:
+
+    class Guard
+    {
+    public:
+
+        Guard()
+            : record_( EpochDomain::instance().record() )
+        {
+            if( record_.depth++ == 0 )
+            {
+                record_.epoch.store( EpochDomain::instance().epoch_.load( std::memory_order_acquire ), std::memory_order_seq_cst );
+            }
+        }
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+        ~Guard()
+        {
+            if( --record_.depth == 0 ) record_.epoch.store( 0, std::memory_order_release );
+        }
+
+    private:
+
+        Record& record_;
+    };
+
+    static EpochDomain& instance()
+    {
+        static EpochDomain domain;
+        return domain;
+    }
+
+    // Returns once every reader which entered before the call has left
+    void synchronize()
+    {
+        const auto target = epoch_.fetch_add( 1, std::memory_order_seq_cst ) + 1;
+        for( auto r = records_.load( std::memory_order_acquire ); r; r = r->next )
+        {
+            for( ;; )
+            {
+                const auto epoch = r->epoch.load( std::memory_order_seq_cst );
+                if( epoch == 0 || epoch >= target ) break;
+                std::this_thread::yield();
+            }
+        }
+    }
+
+private:
+
+    EpochDomain() = default;
+
+    Record& record()
+    {
+        thread_local Registration registration;
+        if( !registration.record ) registration.record = acquire();
+        return *registration.record;
+    }
+
+    Record* acquire()
+    {
+        for( auto r = records_.load( std::memory_order_acquire ); r; r = r->next )
+        {
+            bool used = false;
+            if( r->used.compare_exchange_strong( used, true, std::memory_order_acq_rel ) ) return r;
+        }
+
+        // Records are never freed, so the list can be walked while new ones are pushed
+        auto r = new Record;
+        r->next = records_.load( std::memory_order_relaxed );
+        while( !records_.compare_exchange_weak( r->next, r, std::memory_order_release, std::memory_order_relaxed ) ) {}
+        return r;
+    }
+
+    std::atomic<std::uint64_t> epoch_{ 1 };
+    std::atomic<Record*> records_{ nullptr };
+};
+
+template<class Func>
+class TaskSlot;
+
+// Copyable handler to be stored into a TaskType. Every Task copy calls the same slot.
+template<class Func>
+class TaskSlotRef
+{
+public:
+
+    explicit constexpr TaskSlotRef(const TaskSlot<Func>& slot) noexcept : slot_( &slot ) {}
+
+    template<typename... Args>
+    auto operator()(Args&&... args) const
+    {
+        return (*slot_)( std::forward<Args>(args)... );
+    }
+
+private:
+
+    const TaskSlot<Func>* slot_;
+};
+
+// Handler which can be replaced at runtime while being dispatched. Dispatch is wait-free; replace()
+// blocks the writer until the grace period has elapsed and then reclaims the previous handler, so
+// it must not be called from within a handler.
+// Use std::function as Func to swap handlers of different types.
+template<class Func>
+class TaskSlot
+{
+public:
+
+    explicit TaskSlot(Func f)
+        : current_( new Func( std::move( f ) ) )
+    {}
+
+    TaskSlot(const TaskSlot&) = delete;
+    TaskSlot& operator=(const TaskSlot&) = delete;
+
+    // No dispatch may be running on the slot any more
+    ~TaskSlot()
+    {
+        delete current_.load( std::memory_order_relaxed );
+    }
+
+    template<typename... Args>
+    auto operator()(Args&&... args) const
+    {
+        EpochDomain::Guard guard;
+        return (*current_.load( std::memory_order_seq_cst ))( std::forward<Args>(args)... );
+    }
+
+    void replace(Func f)
+    {
+        auto fresh = new Func( std::move( f ) );
+        std::lock_guard<std::mutex> lock( writer_ );
+        auto old = current_.exchange( fresh, std::memory_order_seq_cst );
+        EpochDomain::instance().synchronize();
+        delete old;
+    }
+
+    TaskSlotRef<Func> ref() const noexcept
+    {
+        return TaskSlotRef<Func>( *this );
+    }
+
+private:
+
+    std::atomic<Func*> current_;
+    std::mutex writer_;
+};
+
+} // taskit namespace
+
+#endif // __TASKIT_HOTSWAP_H__
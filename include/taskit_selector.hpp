@@ -3,49 +3,35 @@
 
 #include "taskit_tasks.hpp"
 
-namespace taskit {
-
-template<typename Head, typename... Tails>
-struct ElseTaskSelector : protected ElseTaskSelector<Tails...>, protected FunctionHolder<Head>
-{
-protected:
+#include <cstddef>
+#include <tuple>
 
-    using task_t = typename Head::type;
+#if defined(__GNUC__) || defined(__clang__)
+#define TASKIT_EXPECT(cond, hot) __builtin_expect( !!(cond), (hot) )
+#else
+#define TASKIT_EXPECT(cond, hot) (cond)
+#endif
 
-    constexpr ElseTaskSelector(task_t type, Head head, Tails... tails)
-        : ElseTaskSelector<Tails...>(type, tails...)
-        , FunctionHolder<Head>( head.getFunctorRef() )
-    {}
-
-    template<typename... Args>
-    constexpr auto operator()(Args&&... args) const
-    {
-        return ElseTaskSelector<Tails...>::type() == Head::value() ?
-            this->FunctionHolder<Head>::exe( std::forward<Args>(args)... ) :
-            ElseTaskSelector<Tails...>::operator()( std::forward<Args>(args)... );
-    }
-};
+namespace taskit {
 
-template<typename Tail>
-struct ElseTaskSelector<Tail> : protected FunctionHolder<Tail>
+template<typename... TaskList>
+struct ElseTaskSelector : protected TaskHolders<TaskList...>
 {
-    using task_t = typename Tail::type;
+    using task_t = typename TaskAt<sizeof...(TaskList) - 1, TaskList...>::type;
 
 protected:
 
-    constexpr ElseTaskSelector(task_t type, Tail tail)
-        : FunctionHolder<Tail>( tail.getFunctorRef() )
+    constexpr ElseTaskSelector(task_t type, TaskList&&... taskList)
+        : TaskHolders<TaskList...>( std::forward<TaskList>(taskList)... )
         , type_( type )
     {}
 
     template<typename... Args>
     constexpr auto operator()(Args&&... args) const
     {
-        return this->FunctionHolder<Tail>::exe( std::forward<Args>(args)... );
+        return elseIf<0>( std::integral_constant<bool, sizeof...(TaskList) == 1>(), std::forward<Args>(args)... );
     }
 
-    constexpr auto type() const noexcept { return type_; }
-
     template<typename T>
     void select(T&& type)
     {
@@ -54,6 +40,20 @@ protected:
 
 private:
 
+    template<std::size_t I, typename... Args>
+    constexpr auto elseIf(std::false_type, Args&&... args) const
+    {
+        return type_ == TaskAt<I, TaskList...>::value() ?
+            this->template exe<I>( std::forward<Args>(args)... ) :
+            elseIf<I + 1>( std::integral_constant<bool, I + 2 == sizeof...(TaskList)>(), std::forward<Args>(args)... );
+    }
+
+    template<std::size_t I, typename... Args>
+    constexpr auto elseIf(std::true_type, Args&&... args) const
+    {
+        return this->template exe<I>( std::forward<Args>(args)... );
+    }
+
     task_t type_;
 };
 
@@ -101,6 +101,244 @@ constexpr auto make_Tasks(TASKS_LIST&&... args)
     return Task<TASKS_LIST...>::make_Task(T(), std::forward<TASKS_LIST>(args)...);
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Compile-time decision plan over the N candidates of a WeightedTask (the default task excluded).
+// Candidates sharing their key with an earlier declared one are dropped and their weight is given
+// to it, as the first declared one is the only one Task would ever select.
+// Expected compares are counted as one per candidate tried by a chain (checked by decreasing
+// weight for ordered keys, in declaration order for class keys), and in a tree, one for the hit plus two (== then <) for every node passed by. The
+// default weight is spread evenly over the gaps between keys, so every weight is scaled by the
+// number of gaps to keep integer arithmetic. Trees are only built for ordered keys, and the
+// cheapest of both shapes is chosen.
+template<std::size_t N>
+struct WeightedTaskPlan
+{
+    std::size_t size = 0;
+    bool tree = false;
+    std::size_t order[N + 1] = {};
+    bool hot[N + 1] = {};
+    std::size_t sorted[N + 1] = {};
+    std::size_t root[N + 1][N + 1] = {};
+    unsigned long long p[N + 1] = {};
+    unsigned long long w[N + 1][N + 1] = {};
+
+    template<typename K>
+    constexpr WeightedTaskPlan(const K (&keys)[N + 1], const std::size_t (&weights)[N + 1], std::size_t defaultWeight, bool ordered)
+    {
+        std::size_t weight[N + 1] = {};
+        for( std::size_t i = 0; i < N; ++i )
+        {
+            std::size_t first = 0;
+            while( first < size && !( keys[order[first]] == keys[i] ) ) ++first;
+            if( first == size ) order[size++] = i;
+            weight[order[first]] += weights[i];
+        }
+
+        // Chain: stable sort by decreasing weight, so ties keep declaration order. Keys only known
+        // by address may still hold equal values, so their declaration order is kept.
+        for( std::size_t i = 1; ordered && i < size; ++i )
+        {
+            for( std::size_t j = i; j > 0 && weight[order[j - 1]] < weight[order[j]]; --j )
+            {
+                auto tmp = order[j];
+                order[j] = order[j - 1];
+                order[j - 1] = tmp;
+            }
+        }
+
+        const unsigned long long gaps = size + 1;
+        const unsigned long long q = defaultWeight;
+        unsigned long long remaining = defaultWeight;
+        unsigned long long chainCost = q * gaps * size;
+        for( std::size_t pos = size; pos > 0; --pos )
+        {
+            remaining += weight[order[pos - 1]];
+            hot[pos - 1] = 2 * weight[order[pos - 1]] > remaining;
+            chainCost += weight[order[pos - 1]] * gaps * pos;
+        }
+
+        if( !ordered ) return;
+
+        // Tree: stable sort by increasing key, then optimal binary search tree (Knuth)
+        for( std::size_t i = 0; i < size; ++i ) sorted[i] = order[i];
+        for( std::size_t i = 1; i < size; ++i )
+        {
+            for( std::size_t j = i; j > 0 && keys[sorted[j]] < keys[sorted[j - 1]]; --j )
+            {
+                auto tmp = sorted[j];
+                sorted[j] = sorted[j - 1];
+                sorted[j - 1] = tmp;
+            }
+        }
+        for( std::size_t i = 0; i < size; ++i ) p[i] = weight[sorted[i]] * gaps;
+
+        unsigned long long e[N + 1][N + 1] = {};
+        for( std::size_t lo = 0; lo <= size; ++lo ) w[lo][lo] = q;
+        for( std::size_t len = 1; len <= size; ++len )
+        {
+            for( std::size_t lo = 0; lo + len <= size; ++lo )
+            {
+                const auto hi = lo + len;
+                w[lo][hi] = w[lo][hi - 1] + p[hi - 1] + q;
+                e[lo][hi] = ~0ull;
+                for( std::size_t r = lo; r < hi; ++r )
+                {
+                    const auto cost = e[lo][r] + e[r + 1][hi] + 2 * w[lo][hi] - p[r];
+                    if( cost < e[lo][hi] )
+                    {
+                        e[lo][hi] = cost;
+                        root[lo][hi] = r;
+                    }
+                }
+            }
+        }
+
+        tree = e[0][size] < chainCost;
+    }
+
+    constexpr bool hit(std::size_t lo, std::size_t hi) const { return 2 * p[root[lo][hi]] > w[lo][hi]; }
+    constexpr bool left(std::size_t lo, std::size_t hi) const { return w[lo][root[lo][hi]] > w[root[lo][hi] + 1][hi]; }
+};
+
+// Keys of class type cannot be compared at compile time, but the objects they refer to can. Distinct
+// objects may hold equal values though, so only a shared object proves a duplicated key.
+template<class Task, bool = std::is_class<typename Task::type>::value>
+struct WeightedTaskKey
+{
+    static constexpr auto of() { return Task::value(); }
+};
+
+template<class Task>
+struct WeightedTaskKey<Task, true>
+{
+    static constexpr const void* of() { return &Task::key(); }
+};
+
+template<class Tasks, std::size_t... I>
+constexpr auto make_WeightedTaskPlan(std::index_sequence<I...>)
+{
+    constexpr std::size_t N = sizeof...(I);
+    using first_t = std::tuple_element_t<0, Tasks>;
+    using task_t = typename first_t::type;
+    using key_t = decltype( WeightedTaskKey<first_t>::of() );
+    const key_t keys[] = { WeightedTaskKey<std::tuple_element_t<I, Tasks>>::of()..., key_t() };
+    const std::size_t weights[] = { std::tuple_element_t<I, Tasks>::weight()..., 0 };
+    return WeightedTaskPlan<N>( keys, weights, std::tuple_element_t<N, Tasks>::weight(),
+                                std::is_integral<task_t>::value || std::is_enum<task_t>::value );
+}
+
+// Same semantics as Task (last task is the default one, the first declared one wins on duplicated
+// keys), but candidates are compared following a decision tree shaped by their declared weights
+// instead of declaration order.
+template<typename... TaskList>
+class WeightedTask : private TaskHolders<TaskList...>
+{
+    using holders_t = TaskHolders<TaskList...>;
+
+    template<std::size_t I>
+    using task_at = TaskAt<I, TaskList...>;
+
+    using task_t = typename task_at<0>::type;
+
+    static constexpr std::size_t N = sizeof...(TaskList) - 1;
+
+    using plan_t = WeightedTaskPlan<N>;
+
+    static constexpr plan_t plan = make_WeightedTaskPlan<std::tuple<TaskList...>>( std::make_index_sequence<N>() );
+
+public:
+
+    template<typename T>
+    static WeightedTask make_WeightedTask(T type, TaskList&&... taskList)
+    {
+        return WeightedTask(type, std::forward<TaskList>(taskList)...);
+    }
+
+    template<typename... Args>
+    constexpr auto operator()(Args&&... args) const
+    {
+        return dispatch( std::integral_constant<bool, plan.tree>(), std::forward<Args>(args)... );
+    }
+
+    template<typename T>
+    auto& select(T&& type)
+    {
+        type_ = std::forward<T>( type );
+        return *this;
+    }
+
+private:
+
+    template<typename T>
+    constexpr WeightedTask(T type, TaskList&&... taskList)
+        : holders_t(std::forward<TaskList>(taskList)...)
+        , type_( type )
+    {}
+
+    template<typename... Args>
+    constexpr auto dispatch(std::false_type, Args&&... args) const
+    {
+        return chain<0>( std::integral_constant<bool, plan.size == 0>(), std::forward<Args>(args)... );
+    }
+
+    template<typename... Args>
+    constexpr auto dispatch(std::true_type, Args&&... args) const
+    {
+        return tree<0, plan.size>( std::integral_constant<bool, plan.size == 0>(), std::forward<Args>(args)... );
+    }
+
+    template<std::size_t Pos, typename... Args>
+    constexpr auto chain(std::false_type, Args&&... args) const
+    {
+        constexpr std::size_t I = plan.order[Pos];
+        return TASKIT_EXPECT( type_ == task_at<I>::value(), plan.hot[Pos] ) ?
+            this->template exe<I>( std::forward<Args>(args)... ) :
+            chain<Pos + 1>( std::integral_constant<bool, Pos + 1 == plan.size>(), std::forward<Args>(args)... );
+    }
+
+    template<std::size_t Pos, typename... Args>
+    constexpr auto chain(std::true_type, Args&&... args) const
+    {
+        return this->template exe<N>( std::forward<Args>(args)... );
+    }
+
+    template<std::size_t Lo, std::size_t Hi, typename... Args>
+    constexpr auto tree(std::false_type, Args&&... args) const
+    {
+        constexpr std::size_t R = plan.root[Lo][Hi];
+        constexpr std::size_t I = plan.sorted[R];
+        return TASKIT_EXPECT( type_ == task_at<I>::value(), plan.hit( Lo, Hi ) ) ?
+            this->template exe<I>( std::forward<Args>(args)... ) :
+            TASKIT_EXPECT( type_ < task_at<I>::value(), plan.left( Lo, Hi ) ) ?
+                tree<Lo, R>( std::integral_constant<bool, Lo == R>(), std::forward<Args>(args)... ) :
+                tree<R + 1, Hi>( std::integral_constant<bool, R + 1 == Hi>(), std::forward<Args>(args)... );
+    }
+
+    template<std::size_t Lo, std::size_t Hi, typename... Args>
+    constexpr auto tree(std::true_type, Args&&... args) const
+    {
+        return this->template exe<N>( std::forward<Args>(args)... );
+    }
+
+    task_t type_;
+};
+
+template<typename... TaskList>
+constexpr typename WeightedTask<TaskList...>::plan_t WeightedTask<TaskList...>::plan;
+
+template<typename T, typename... TASKS_LIST>
+constexpr auto make_WeightedTask(T type, TASKS_LIST&&... args)
+{
+    return WeightedTask<TASKS_LIST...>::make_WeightedTask(type, std::forward<TASKS_LIST>(args)...);
+}
+
+template<typename T, typename... TASKS_LIST>
+constexpr auto make_WeightedTasks(TASKS_LIST&&... args)
+{
+    return WeightedTask<TASKS_LIST...>::make_WeightedTask(T(), std::forward<TASKS_LIST>(args)...);
+}
+
 } // taskit namespace
 
 #endif // __TASKIT_SELECTOR_H__
@@ -2,40 +2,60 @@
 #define __TASKIT_SEQUENCE_H__
 
 #include "taskit_tasks.hpp"
+#include "taskit_deadline.hpp"
+
+#include <bitset>
+#include <cstddef>
 
 namespace taskit {
 
-template<typename Head, typename... Tails>
-struct NextTaskSequence : protected NextTaskSequence<Tails...>, protected FunctionHolder<Head>
+template<typename... TaskList>
+struct NextTaskSequence : protected TaskHolders<TaskList...>
 {
 protected:
 
-    constexpr NextTaskSequence(Head head, Tails... tails)
-        : NextTaskSequence<Tails...>( tails... )
-        , FunctionHolder<Head>( head.getFunctorRef() )
+    constexpr NextTaskSequence(TaskList&&... taskList)
+        : TaskHolders<TaskList...>( std::forward<TaskList>(taskList)... )
     {}
 
     template<typename... Args>
     constexpr auto operator()(Args&&... args) const
     {
-        this->FunctionHolder<Head>::exe( std::forward<Args>(args)... );
-        return NextTaskSequence<Tails...>::operator()( std::forward<Args>(args)... );
+        return next<0>( std::integral_constant<bool, sizeof...(TaskList) == 1>(), std::forward<Args>(args)... );
     }
-};
 
-template<typename Tail>
-struct NextTaskSequence<Tail> : protected FunctionHolder<Tail>
-{
-protected:
+    template<class Batch, typename... Args>
+    constexpr void runBatch(Batch& batch, Args&... args) const
+    {
+        nextBatch<0>( std::integral_constant<bool, sizeof...(TaskList) == 1>(), batch, args... );
+    }
 
-    constexpr NextTaskSequence(Tail tail)
-        : FunctionHolder<Tail>( tail.getFunctorRef() )
-    {}
+private:
 
-    template<typename... Args>
-    constexpr auto operator()(Args&&... args) const
+    template<std::size_t I, typename... Args>
+    constexpr auto next(std::false_type, Args&&... args) const
+    {
+        this->template exe<I>( std::forward<Args>(args)... );
+        return next<I + 1>( std::integral_constant<bool, I + 2 == sizeof...(TaskList)>(), std::forward<Args>(args)... );
+    }
+
+    template<std::size_t I, typename... Args>
+    constexpr auto next(std::true_type, Args&&... args) const
     {
-        return this->FunctionHolder<Tail>::exe( std::forward<Args>(args)... );
+        return this->template exe<I>( std::forward<Args>(args)... );
+    }
+
+    template<std::size_t I, class Batch, typename... Args>
+    constexpr void nextBatch(std::false_type, Batch& batch, Args&... args) const
+    {
+        this->template exeBatch<I>( batch, args... );
+        nextBatch<I + 1>( std::integral_constant<bool, I + 2 == sizeof...(TaskList)>(), batch, args... );
+    }
+
+    template<std::size_t I, class Batch, typename... Args>
+    constexpr void nextBatch(std::true_type, Batch& batch, Args&... args) const
+    {
+        this->template exeBatch<I>( batch, args... );
     }
 };
 
@@ -55,6 +75,14 @@ public:
        return NextTaskSequence<TaskList...>::operator()( std::forward<Args>(args)... );
     }
 
+    // Stage-major execution: every stage goes over the whole batch before the next one starts,
+    // so each stage code and tables are loaded once per batch instead of once per item.
+    template<class Batch, typename... Args>
+    constexpr void runBatch(Batch&& batch, Args&&... args) const
+    {
+        NextTaskSequence<TaskList...>::runBatch( batch, args... );
+    }
+
 private:
 
     constexpr TaskSequence(TaskList&&... taskList)
@@ -68,6 +96,78 @@ constexpr auto make_TaskSequence(TASKS_LIST&&... args)
     return TaskSequence<TASKS_LIST...>::make_TaskSequence( std::forward<TASKS_LIST>(args)... );
 }
 
+template<std::size_t N>
+using StagesRun = std::bitset<N>;
+
+template<typename... TaskList>
+struct NextDeadlineTaskSequence : protected TaskHolders<TaskList...>
+{
+protected:
+
+    constexpr NextDeadlineTaskSequence(TaskList&&... taskList)
+        : TaskHolders<TaskList...>( std::forward<TaskList>(taskList)... )
+    {}
+
+    template<typename DeadlineT, typename... Args>
+    void run(DeadlineT& deadline, StagesRun<sizeof...(TaskList)>& report, Args&&... args) const
+    {
+        stage<0>( std::false_type(), deadline, report, std::forward<Args>(args)... );
+    }
+
+private:
+
+    template<std::size_t I, typename DeadlineT, typename... Args>
+    void stage(std::false_type, DeadlineT& deadline, StagesRun<sizeof...(TaskList)>& report, Args&&... args) const
+    {
+        // Mandatory stages never read the clock
+        if( TaskAt<I, TaskList...>::stageImportance() == StageImportance::mandatory || !deadline.expired() )
+        {
+            this->template exe<I>( std::forward<Args>(args)... );
+            report.set( I );
+        }
+        stage<I + 1>( std::integral_constant<bool, I + 1 == sizeof...(TaskList)>(), deadline, report, std::forward<Args>(args)... );
+    }
+
+    template<std::size_t I, typename DeadlineT, typename... Args>
+    void stage(std::true_type, DeadlineT&, StagesRun<sizeof...(TaskList)>&, Args&&...) const
+    {}
+};
+
+// Runs every mandatory stage and optional ones only while the deadline has not expired.
+// Returns which stages ran, indexed in declaration order.
+template<typename... TaskList>
+class DeadlineTaskSequence : private NextDeadlineTaskSequence<TaskList...>
+{
+public:
+
+    using report_t = StagesRun<sizeof...(TaskList)>;
+
+    static DeadlineTaskSequence make_DeadlineTaskSequence(TaskList&&... taskList)
+    {
+        return DeadlineTaskSequence(std::forward<TaskList>(taskList)...);
+    }
+
+    template<typename DeadlineT, typename... Args>
+    auto operator()(DeadlineT&& deadline, Args&&... args) const
+    {
+        report_t report;
+        NextDeadlineTaskSequence<TaskList...>::run( deadline, report, std::forward<Args>(args)... );
+        return report;
+    }
+
+private:
+
+    constexpr DeadlineTaskSequence(TaskList&&... taskList)
+        : NextDeadlineTaskSequence<TaskList...>(std::forward<TaskList>(taskList)...)
+    {}
+};
+
+template<typename... TASKS_LIST>
+constexpr auto make_DeadlineTaskSequence(TASKS_LIST&&... args)
+{
+    return DeadlineTaskSequence<TASKS_LIST...>::make_DeadlineTaskSequence( std::forward<TASKS_LIST>(args)... );
+}
+
 } // taskit namespace
 
 #endif // __TASKIT_SEQUENCE_H__
@@ -1,6 +1,9 @@
 #ifndef __TASKIT_TASKS_H__
 #define __TASKIT_TASKS_H__
 
+#include <cstddef>
+#include <iterator>
+#include <tuple>
 #include <utility>
 #include <type_traits>
 
@@ -11,6 +14,10 @@ struct PrintType;
 
 enum class ExternalFunctorObjectToBeCached { yes, no };
 
+enum class StageImportance { mandatory, optional };
+
+constexpr std::size_t cacheLineSize = 64;
+
 template<typename T, std::conditional_t<std::is_class<T>::value, T&, T> val, ExternalFunctorObjectToBeCached external, class Func>
 class TaskType
 {
@@ -21,10 +28,14 @@ public:
     using type = T;
     using func = Func;
     constexpr static const auto value() noexcept { return val; }
+    constexpr static decltype(auto) key() noexcept { return val; }
 
     explicit constexpr TaskType(Func&& f) : f_( std::forward<Func>( f ) ) {}
 
     static constexpr const auto cacheExternalFunctorObject() noexcept { return ExternalFunctorObjectToBeCached::yes; }
+    static constexpr const auto stageImportance() noexcept { return StageImportance::mandatory; }
+    static constexpr std::size_t weight() noexcept { return 1; }
+    static constexpr bool hot() noexcept { return false; }
     constexpr Func getFunctorRef() const noexcept( noexcept( f_ ) ) { return f_; }
 };
 
@@ -34,28 +45,96 @@ struct TaskType<T, val, ExternalFunctorObjectToBeCached::no, Func>
     using type = T;
     using func = Func;
     constexpr static const auto value() noexcept { return val; }
+    constexpr static decltype(auto) key() noexcept { return val; }
 
     static constexpr const auto cacheExternalFunctorObject() noexcept { return ExternalFunctorObjectToBeCached::no; }
+    static constexpr const auto stageImportance() noexcept { return StageImportance::mandatory; }
+    static constexpr std::size_t weight() noexcept { return 1; }
+    static constexpr bool hot() noexcept { return false; }
     constexpr Func getFunctorRef() const noexcept( noexcept( Func() ) ) { return Func(); }
 };
 
+// Stages may provide batch(batch, args...) to process a whole batch per call (e.g. columnar
+// layouts or SIMD friendly loops). Otherwise the stage is called once per item of the batch.
+template<class Func, class Batch, typename... Args>
+constexpr auto exeBatch(const Func& f, int, Batch& batch, Args&... args) -> decltype( f.batch( batch, args... ), void() )
+{
+    f.batch( batch, args... );
+}
+
+template<class Batch, class = void>
+struct IsItemBatch : std::false_type {};
+
+template<class Batch>
+struct IsItemBatch<Batch, decltype( std::begin( std::declval<Batch&>() ), std::end( std::declval<Batch&>() ), void() )> : std::true_type {};
+
+template<class Func, class Batch, typename... Args>
+constexpr void exeEach(const Func& f, std::true_type, Batch& batch, Args&... args)
+{
+    for( auto&& item : batch ) f( item, args... );
+}
+
+template<class Func, class Batch, typename... Args>
+constexpr void exeEach(const Func&, std::false_type, Batch&, Args&...) {}
+
+template<class Func, class Batch, typename... Args>
+constexpr void exeBatch(const Func& f, long, Batch& batch, Args&... args)
+{
+    static_assert( IsItemBatch<Batch>::value,
+                   "stage has no batch(batch, args...) member and the batch is not a range of items: "
+                   "every stage must be batch-aware to run over a columnar batch" );
+    exeEach( f, IsItemBatch<Batch>(), batch, args... );
+}
+
+// Cached functors without state (e.g. captureless lambdas) take no room thanks to empty base optimization
+template<class Func, bool = std::is_empty<Func>::value && !std::is_final<Func>::value>
+class FunctorStorage
+{
+    Func f_;
+
+protected:
+
+    explicit constexpr FunctorStorage(Func&& func)
+        : f_( std::forward<Func>( func ) )
+    {}
+
+    constexpr const Func& functor() const noexcept { return f_; }
+};
+
+template<class Func>
+class FunctorStorage<Func, true> : private Func
+{
+protected:
+
+    explicit constexpr FunctorStorage(Func&& func)
+        : Func( std::forward<Func>( func ) )
+    {}
+
+    constexpr const Func& functor() const noexcept { return *this; }
+};
+
 template<class Holder, ExternalFunctorObjectToBeCached val = Holder::cacheExternalFunctorObject()>
-class FunctionHolder
+class FunctionHolder : private FunctorStorage<typename Holder::func>
 {
     using functor_t = typename Holder::func;
-
-    functor_t f_;
+    using storage_t = FunctorStorage<functor_t>;
 
 protected:
 
     explicit constexpr FunctionHolder(functor_t&& func)
-        : f_( std::forward<functor_t>( func ) )
+        : storage_t( std::forward<functor_t>( func ) )
     {}
 
     template<typename... Args>
-    constexpr auto exe(Args&&... args) const noexcept( noexcept( FunctionHolder::f_( std::forward<Args>(args)... ) ) )
+    constexpr auto exe(Args&&... args) const noexcept( noexcept( std::declval<const functor_t&>()( std::forward<Args>(args)... ) ) )
+    {
+        return storage_t::functor()( std::forward<Args>(args)... );
+    }
+
+    template<class Batch, typename... Args>
+    constexpr void exeBatch(Batch& batch, Args&... args) const
     {
-        return f_( std::forward<Args>(args)... );
+        taskit::exeBatch( storage_t::functor(), 0, batch, args... );
     }
 };
 
@@ -73,6 +152,12 @@ protected:
     {
         return functor_t()( std::forward<Args>(args)... );
     }
+
+    template<class Batch, typename... Args>
+    constexpr void exeBatch(Batch& batch, Args&... args) const
+    {
+        taskit::exeBatch( functor_t(), 0, batch, args... );
+    }
 };
 
 template<typename T, std::conditional_t<std::is_class<T>::value, T&, T> val, class Func>
@@ -111,6 +196,173 @@ constexpr auto make_TaskType(Args&&... args)
     return make_TaskType<T, val, Func>( Func( std::forward<Args>(args)... ) );
 }
 
+// Marks a stage as skippable once the budget of a DeadlineTaskSequence has been exhausted
+template<class Task>
+struct OptionalTaskType : Task
+{
+    explicit constexpr OptionalTaskType(Task task) : Task( std::move( task ) ) {}
+
+    static constexpr const auto stageImportance() noexcept { return StageImportance::optional; }
+};
+
+template<class Task>
+constexpr auto make_OptionalTaskType(Task&& task)
+{
+    return OptionalTaskType<std::decay_t<Task>>( std::forward<Task>( task ) );
+}
+
+// Declares how often a task is expected to be selected, relative to the rest of a WeightedTask
+template<class Task, std::size_t Weight>
+struct WeightedTaskType : Task
+{
+    explicit constexpr WeightedTaskType(Task task) : Task( std::move( task ) ) {}
+
+    static constexpr std::size_t weight() noexcept { return Weight; }
+};
+
+template<std::size_t Weight, class Task>
+constexpr auto make_WeightedTaskType(Task&& task)
+{
+    return WeightedTaskType<std::decay_t<Task>, Weight>( std::forward<Task>( task ) );
+}
+
+// Gives the task state its own cache line(s), so it does not share them with colder tasks state
+template<class Task>
+struct HotTaskType : Task
+{
+    explicit constexpr HotTaskType(Task task) : Task( std::move( task ) ) {}
+
+    static constexpr bool hot() noexcept { return true; }
+};
+
+template<class Task>
+constexpr auto make_HotTaskType(Task&& task)
+{
+    return HotTaskType<std::decay_t<Task>>( std::forward<Task>( task ) );
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template<std::size_t I, class... TaskList>
+using TaskAt = std::tuple_element_t<I, std::tuple<TaskList...>>;
+
+template<std::size_t I, class Head, bool hot = Head::hot() && !std::is_empty<FunctionHolder<Head>>::value>
+struct IndexedFunctionHolder : protected FunctionHolder<Head>
+{
+protected:
+
+    explicit constexpr IndexedFunctionHolder(Head head)
+        : FunctionHolder<Head>( head.getFunctorRef() )
+    {}
+};
+
+// Hot state is kept as a member, as the tail padding of a base class could be reused by colder state
+template<std::size_t I, class Head>
+struct IndexedFunctionHolder<I, Head, true>
+{
+protected:
+
+    explicit constexpr IndexedFunctionHolder(Head head)
+        : line_( std::move( head ) )
+    {}
+
+    template<typename... Args>
+    constexpr auto exe(Args&&... args) const
+    {
+        return line_.exe( std::forward<Args>(args)... );
+    }
+
+    template<class Batch, typename... Args>
+    constexpr void exeBatch(Batch& batch, Args&... args) const
+    {
+        line_.exeBatch( batch, args... );
+    }
+
+private:
+
+    struct alignas(cacheLineSize) Line : FunctionHolder<Head>
+    {
+        explicit constexpr Line(Head head)
+            : FunctionHolder<Head>( head.getFunctorRef() )
+        {}
+
+        using FunctionHolder<Head>::exe;
+        using FunctionHolder<Head>::exeBatch;
+    };
+
+    Line line_;
+};
+
+// Storage order of the task functors: hot ones first, then by decreasing alignment so that
+// no padding is needed between them. Stateless functors have alignment 1 and take no room.
+template<class... TaskList>
+struct TaskLayout
+{
+    static constexpr std::size_t at(std::size_t pos)
+    {
+        constexpr std::size_t N = sizeof...(TaskList);
+        const bool hot[] = { ( TaskList::hot() && !std::is_empty<FunctionHolder<TaskList>>::value )... };
+        const std::size_t align[] = { alignof( IndexedFunctionHolder<0, TaskList> )... };
+
+        std::size_t order[N] = {};
+        for( std::size_t i = 0; i < N; ++i ) order[i] = i;
+        for( std::size_t i = 1; i < N; ++i )
+        {
+            for( std::size_t j = i; j > 0; --j )
+            {
+                const auto a = order[j - 1], b = order[j];
+                if( hot[a] > hot[b] || ( hot[a] == hot[b] && align[a] >= align[b] ) ) break;
+                order[j - 1] = b;
+                order[j] = a;
+            }
+        }
+        return order[pos];
+    }
+
+    template<std::size_t... Pos>
+    static auto sequence(std::index_sequence<Pos...>) -> std::index_sequence<at( Pos )...>;
+
+    using type = decltype( sequence( std::index_sequence_for<TaskList...>() ) );
+};
+
+template<class Layout, class... TaskList>
+struct IndexedTaskHolders;
+
+template<std::size_t... L, class... TaskList>
+struct IndexedTaskHolders<std::index_sequence<L...>, TaskList...> : protected IndexedFunctionHolder<L, TaskAt<L, TaskList...>>...
+{
+protected:
+
+    template<std::size_t I>
+    using task_at = TaskAt<I, TaskList...>;
+
+    constexpr IndexedTaskHolders(TaskList&&... taskList)
+        : IndexedTaskHolders( std::forward_as_tuple( std::forward<TaskList>(taskList)... ) )
+    {}
+
+    template<std::size_t I, typename... Args>
+    constexpr auto exe(Args&&... args) const
+    {
+        return this->IndexedFunctionHolder<I, task_at<I>>::exe( std::forward<Args>(args)... );
+    }
+
+    template<std::size_t I, class Batch, typename... Args>
+    constexpr void exeBatch(Batch& batch, Args&... args) const
+    {
+        this->IndexedFunctionHolder<I, task_at<I>>::exeBatch( batch, args... );
+    }
+
+private:
+
+    constexpr IndexedTaskHolders(std::tuple<TaskList&&...> tasks)
+        : IndexedFunctionHolder<L, task_at<L>>( std::get<L>( std::move( tasks ) ) )...
+    {}
+};
+
+// Functors of a task list, addressed by their declaration index but laid out by TaskLayout
+template<class... TaskList>
+using TaskHolders = IndexedTaskHolders<typename TaskLayout<TaskList...>::type, TaskList...>;
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #if __cplusplus >= 201703L
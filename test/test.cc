@@ -4,7 +4,10 @@
 #include "taskit.hpp"
 
 #include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <chrono>
 #include <future>
+#include <thread>
 
 #include <iostream>
 #include <sstream>
@@ -12,7 +15,9 @@
 #include <vector>
 #include <fstream>
 #include <string>
+#include <system_error>
 #include <algorithm>
+#include <cctype>
 
 class Ctx
 {
@@ -344,4 +349,414 @@ BOOST_AUTO_TEST_CASE( tasks_sizes_test )
                                    );
 
     BOOST_CHECK( sizeof parser == 1 );
+
+    // Stateless lambdas cached by value take no room either
+    auto stateless = taskit::make_Task( parser_selector,
+                                        taskit::make_TaskType<char, 'A'>( [](int) { return 'A'; } ),
+                                        taskit::make_TaskType<char, 'B'>( [](int) { return 'B'; } ),
+                                        taskit::make_TaskType<char, 'C', C>()
+                                      );
+
+    BOOST_CHECK( sizeof stateless == 1 );
+
+    // Stored state is ordered by decreasing alignment: double, int, char, char and the selector
+    char letter = 'e';
+    int code = 100;
+    double ratio = 0.5;
+    auto mixed = taskit::make_Task( parser_selector,
+                                    taskit::make_TaskType<char, 'A'>( [letter](int) { return letter; } ),
+                                    taskit::make_TaskType<char, 'B'>( [](int) { return 'B'; } ),
+                                    taskit::make_TaskType<char, 'C'>( [ratio](int) { return ratio > 0 ? 'C' : 'c'; } ),
+                                    taskit::make_TaskType<char, 'D'>( [letter](int) { return letter; } ),
+                                    taskit::make_TaskType<char, 'E'>( [code](int) { return static_cast<char>( code ); } )
+                                  );
+
+    BOOST_CHECK( alignof( decltype( mixed ) ) == alignof( double ) );
+    BOOST_CHECK( sizeof mixed == 2 * sizeof( double ) );
+    BOOST_CHECK( mixed.select( 'C' )(0) == 'C' );
+    BOOST_CHECK( mixed.select( 'x' )(0) == 'd' );
+
+    auto sequence = taskit::make_TaskSequence(
+                                    taskit::make_TaskType( [letter](int) { return letter; } ),
+                                    taskit::make_TaskType( [](int) { return 0; } ),
+                                    taskit::make_TaskType( [ratio](int) { return ratio; } )
+                                   );
+
+    BOOST_CHECK( sizeof sequence == sizeof( double ) + sizeof( double ) );
+
+    // Hot stateful functors get their own cache line, stateless ones are left as they are
+    auto hot = taskit::make_Task( parser_selector,
+                                  taskit::make_HotTaskType( taskit::make_TaskType<char, 'A'>( [letter](int) { return letter; } ) ),
+                                  taskit::make_HotTaskType( taskit::make_TaskType<char, 'B'>( [](int) { return 'B'; } ) ),
+                                  taskit::make_TaskType<char, 'C'>( [code](int) { return static_cast<char>( code ); } )
+                                );
+
+    BOOST_CHECK( alignof( decltype( hot ) ) == taskit::cacheLineSize );
+    BOOST_CHECK( sizeof hot == 2 * taskit::cacheLineSize );
+    BOOST_CHECK( hot.select( 'A' )(0) == 'e' );
+}
+
+BOOST_AUTO_TEST_CASE( deadline_sequence_test )
+{
+    using namespace std::chrono_literals;
+
+    auto a = [](std::ostream& os, Ctx&) { os << 'a'; };
+    auto b = [](std::ostream& os, Ctx&) { os << 'b'; };
+    auto c = [](std::ostream& os, Ctx&) { os << 'c'; };
+    auto d = [](std::ostream& os, Ctx&) { os << 'd'; };
+
+    auto normalizer = taskit::make_DeadlineTaskSequence(
+                                              taskit::make_TaskType( std::move( a ) ),
+                                              taskit::make_OptionalTaskType( taskit::make_TaskType( std::move( b ) ) ),
+                                              taskit::make_TaskType( std::move( c ) ),
+                                              taskit::make_OptionalTaskType( taskit::make_TaskType( std::move( d ) ) )
+                                             );
+
+    Ctx ctx;
+
+    std::stringstream relaxed;
+    auto ran = normalizer(taskit::make_Deadline( 1h ), relaxed, ctx);
+    BOOST_CHECK( relaxed.str() == "abcd" );
+    BOOST_CHECK( ran.all() );
+
+    std::stringstream exhausted;
+    ran = normalizer(taskit::make_Deadline<taskit::CycleClock>( 0u ), exhausted, ctx);
+    BOOST_CHECK( exhausted.str() == "ac" );
+    BOOST_CHECK( ran.to_string() == "0101" );
+}
+
+// Manual clock counting how many times it is read
+struct CountingClock
+{
+    static int reads;
+    static int ticks;
+
+    static int now()
+    {
+        ++reads;
+        return ticks;
+    }
+};
+
+int CountingClock::reads = 0;
+int CountingClock::ticks = 0;
+
+BOOST_AUTO_TEST_CASE( deadline_check_every_test )
+{
+    auto deadline = taskit::make_Deadline<CountingClock, 3>( 10 );
+    BOOST_CHECK( CountingClock::reads == 1 );
+
+    // The clock is read on the first check and then once every 3 checks
+    BOOST_CHECK( !deadline.expired() );
+    BOOST_CHECK( CountingClock::reads == 2 );
+    CountingClock::ticks = 10;
+    BOOST_CHECK( !deadline.expired() );
+    BOOST_CHECK( !deadline.expired() );
+    BOOST_CHECK( CountingClock::reads == 2 );
+    BOOST_CHECK( deadline.expired() );
+    BOOST_CHECK( CountingClock::reads == 3 );
+
+    // Once expired the clock is not read any more
+    BOOST_CHECK( deadline.expired() );
+    BOOST_CHECK( deadline.expired() );
+    BOOST_CHECK( deadline.expired() );
+    BOOST_CHECK( deadline.expired() );
+    BOOST_CHECK( CountingClock::reads == 3 );
+}
+
+enum class Msg { a, b, c, d, unknown };
+
+std::string the_again_s("the");
+
+BOOST_AUTO_TEST_CASE( weighted_selector_test )
+{
+    using namespace std::string_literals;
+
+    auto e = [](std::ostream& os, Ctx& ctx)
+    {
+        ctx.storeInfo("eeeee eeeee eeeee");
+        os << " " << ctx << " ...";
+        return 'e';
+    };
+
+    constexpr const char stages[] = { 'A', 'B', 'C', 'd', 'e', 'x' };
+
+    std::stringstream res;
+
+    for( auto parser_selector : stages )
+    {
+        auto parser = taskit::make_WeightedTask( parser_selector,
+                                                   taskit::make_WeightedTaskType<5>( taskit::make_TaskType<char, 'A', A>() ),
+                                                   taskit::make_WeightedTaskType<70>( taskit::make_TaskType<char, 'B'>( B{} ) ),
+                                                   taskit::make_TaskType<char, 'C', C>(),
+                                                   taskit::make_WeightedTaskType<20>( taskit::make_TaskType<char, 'd'>( std::move( d ) ) ),
+                                                   taskit::make_WeightedTaskType<3>( taskit::make_TaskType<char, '0'>( std::move( e ) ) )
+                                                 );
+
+        Ctx ctx;
+
+        auto ret = parser(res, ctx);
+
+        BOOST_CHECK( ret == ( parser_selector == 'x' ? 'e' : parser_selector ) );
+    }
+
+    BOOST_CHECK( res.str() == " A A A ... BB BB BB ... CCC CCC CCC ... dddd dddd dddd ... eeeee eeeee eeeee ... eeeee eeeee eeeee ..." );
+
+    auto msgs = taskit::make_WeightedTasks<Msg>(
+                                    taskit::make_WeightedTaskType<1>( taskit::make_TaskType<Msg, Msg::a>( [](int) { return 0; } ) ),
+                                    taskit::make_WeightedTaskType<9>( taskit::make_TaskType<Msg, Msg::b>( [](int) { return 1; } ) ),
+                                    taskit::make_WeightedTaskType<4>( taskit::make_TaskType<Msg, Msg::c>( [](int) { return 2; } ) ),
+                                    taskit::make_WeightedTaskType<2>( taskit::make_TaskType<Msg, Msg::d>( [](int) { return 3; } ) ),
+                                    taskit::make_TaskType<Msg, Msg::unknown>( [](int) { return -1; } ) );
+
+    BOOST_CHECK( msgs.select( Msg::a )(0) == 0 );
+    BOOST_CHECK( msgs.select( Msg::b )(0) == 1 );
+    BOOST_CHECK( msgs.select( Msg::c )(0) == 2 );
+    BOOST_CHECK( msgs.select( Msg::d )(0) == 3 );
+    BOOST_CHECK( msgs.select( Msg::unknown )(0) == -1 );
+
+    auto words = taskit::make_WeightedTasks<std::string>(
+                                    taskit::make_TaskType<decltype(the_s), the_s>( [](int) { return 1; } ),
+                                    taskit::make_WeightedTaskType<10>( taskit::make_TaskType<decltype(you_s), you_s>( [](int) { return 2; } ) ),
+                                    taskit::make_TaskType<decltype(empty_s), empty_s>( [](int) { return 0; } ) );
+
+    BOOST_CHECK( words.select( "the"s )(0) == 1 );
+    BOOST_CHECK( words.select( "you"s )(0) == 2 );
+    BOOST_CHECK( words.select( "Goʹshen"s )(0) == 0 );
+
+    // The first declared task wins on duplicated keys, whatever the weights
+    for( int key : { 5, 7 } )
+    {
+        auto plain = taskit::make_Task( key,
+                                        taskit::make_TaskType<int, 5>( [] { return 1; } ),
+                                        taskit::make_TaskType<int, 5>( [] { return 2; } ),
+                                        taskit::make_TaskType<int, 0>( [] { return 0; } ) );
+
+        auto tree = taskit::make_WeightedTask( key,
+                                               taskit::make_TaskType<int, 5>( [] { return 1; } ),
+                                               taskit::make_WeightedTaskType<100>( taskit::make_TaskType<int, 5>( [] { return 2; } ) ),
+                                               taskit::make_WeightedTaskType<50>( taskit::make_TaskType<int, 7>( [] { return 3; } ) ),
+                                               taskit::make_TaskType<int, 0>( [] { return 0; } ) );
+
+        BOOST_CHECK( plain() == ( key == 5 ? 1 : 0 ) );
+        BOOST_CHECK( tree() == ( key == 5 ? 1 : 3 ) );
+    }
+
+    auto dupWords = taskit::make_WeightedTasks<std::string>(
+                                    taskit::make_TaskType<decltype(the_s), the_s>( [](int) { return 1; } ),
+                                    taskit::make_WeightedTaskType<100>( taskit::make_TaskType<decltype(the_s), the_s>( [](int) { return 2; } ) ),
+                                    taskit::make_TaskType<decltype(empty_s), empty_s>( [](int) { return 0; } ) );
+
+    BOOST_CHECK( dupWords.select( "the"s )(0) == 1 );
+    BOOST_CHECK( dupWords.select( "you"s )(0) == 0 );
+
+    // Distinct key objects holding the same value are duplicated keys too
+    auto sameWords = taskit::make_WeightedTasks<std::string>(
+                                    taskit::make_TaskType<decltype(the_s), the_s>( [](int) { return 1; } ),
+                                    taskit::make_WeightedTaskType<100>( taskit::make_TaskType<decltype(the_again_s), the_again_s>( [](int) { return 2; } ) ),
+                                    taskit::make_TaskType<decltype(empty_s), empty_s>( [](int) { return 0; } ) );
+
+    BOOST_CHECK( sameWords.select( "the"s )(0) == 1 );
+}
+
+BOOST_AUTO_TEST_CASE( sharded_dispatcher_test )
+{
+    struct Message
+    {
+        int key;
+        std::atomic<int>* hits;
+    };
+
+    std::atomic<int> hits[4] = {};
+    std::atomic<std::thread::id> owner[4] = {};
+
+    auto handler = [&owner](Message& msg)
+    {
+        std::thread::id none;
+        owner[msg.key].compare_exchange_strong( none, std::this_thread::get_id() );
+        if( owner[msg.key].load() == std::this_thread::get_id() ) msg.hits[msg.key]++;
+    };
+
+    auto tasks = taskit::make_Tasks<int>(
+                                    taskit::make_TaskType<int, 0>( handler ),
+                                    taskit::make_TaskType<int, 1>( handler ),
+                                    taskit::make_TaskType<int, 2>( handler ),
+                                    taskit::make_TaskType<int, 3>( handler ) );
+
+    // Keys 0 and 2 both land on shard 0 and carry most of the traffic
+    auto dispatcher = taskit::make_ShardedDispatcher<Message>( tasks, [](const Message& msg) { return msg.key; },
+                                                              2, 4, [](int key) { return static_cast<std::size_t>( key ); } );
+
+    for( int i = 0; i < 1000; ++i )
+    {
+        dispatcher->dispatch( Message{ i % 10 < 8 ? ( i % 2 ) * 2 : 1 + ( i % 2 ) * 2, hits } );
+    }
+    dispatcher->wait();
+
+    BOOST_CHECK( hits[0] + hits[1] + hits[2] + hits[3] == 1000 );
+    BOOST_CHECK( dispatcher->stats(0).processed == 800 );
+    BOOST_CHECK( dispatcher->stats(1).processed == 200 );
+
+    BOOST_CHECK( dispatcher->rebalance() == 1 );
+    BOOST_CHECK( dispatcher->shardOf( Message{ 0, hits } ) != dispatcher->shardOf( Message{ 2, hits } ) );
+
+    // Idle workers are parked by now and must be woken up
+    std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+    BOOST_CHECK( dispatcher->dispatch( Message{ 3, hits } ) );
+    dispatcher->wait();
+    BOOST_CHECK( hits[3] == 101 );
+
+    dispatcher->stop();
+    BOOST_CHECK( !dispatcher->dispatch( Message{ 3, hits } ) );
+    dispatcher->wait();
+
+    // Spinning workers behind queues shorter than the burst
+    auto spinning = taskit::make_ShardedDispatcher<Message>( tasks, [](const Message& msg) { return msg.key; },
+                                                             2, 4, [](int key) { return static_cast<std::size_t>( key ); },
+                                                             {}, taskit::ShardIdle::spin, 2 );
+    for( int i = 0; i < 1000; ++i ) spinning->dispatch( Message{ i % 4, hits } );
+    spinning->wait();
+    BOOST_CHECK( spinning->stats(0).processed + spinning->stats(1).processed == 1000 );
+
+    BOOST_CHECK_THROW( taskit::make_ShardedDispatcher<Message>( tasks, [](const Message& msg) { return msg.key; }, 2, 4,
+                                                                [](int key) { return static_cast<std::size_t>( key ); }, { -1, 1 << 20 } ),
+                       std::system_error );
+
+    // Messages only need to be move constructible
+    struct Order
+    {
+        explicit Order(int k) : key( k ) {}
+        Order(Order&&) = default;
+        Order& operator=(Order&&) = delete;
+
+        int key;
+    };
+
+    std::atomic<int> orders{ 0 };
+    auto count = [&orders](Order& order) { orders += order.key; };
+    auto orderTasks = taskit::make_Tasks<int>( taskit::make_TaskType<int, 1>( count ),
+                                               taskit::make_TaskType<int, 0>( count ) );
+    auto orderDispatcher = taskit::make_ShardedDispatcher<Order>( orderTasks, [](const Order& order) { return order.key; }, 2 );
+    for( int i = 0; i < 100; ++i ) orderDispatcher->dispatch( Order( i % 2 ) );
+    orderDispatcher->wait();
+    BOOST_CHECK( orders == 50 );
+}
+
+struct ConvertToLowCase
+{
+    void operator()(std::string& s, std::string& log) const
+    {
+        std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
+        log += 'l';
+    }
+};
+
+struct CollapseTabsIntoSimpleSpaces
+{
+    void batch(std::vector<std::string>& batch, std::string& log) const
+    {
+        for( auto& s : batch ) std::replace(s.begin(), s.end(), '\t', ' ');
+        log += 'C';
+    }
+};
+
+struct Columns
+{
+    std::vector<char> type;
+    std::vector<std::string> text;
+};
+
+struct UpperCaseTypes
+{
+    void batch(Columns& columns) const
+    {
+        for( auto& t : columns.type ) t = static_cast<char>( std::toupper( t ) );
+    }
+};
+
+struct DropShortTexts
+{
+    void batch(Columns& columns) const
+    {
+        for( auto& s : columns.text ) if( s.size() < 3 ) s.clear();
+    }
+};
+
+BOOST_AUTO_TEST_CASE( batch_sequence_test )
+{
+    auto normalizer = taskit::make_TaskSequence(
+                                              taskit::make_TaskType<CollapseTabsIntoSimpleSpaces>(),
+                                              taskit::make_TaskType<ConvertToLowCase>()
+                                             );
+
+    std::vector<std::string> batch = { "Hello\tWorld", "GOOD\tBye", "Goʹshen" };
+    std::string log;
+
+    normalizer.runBatch(batch, log);
+
+    BOOST_CHECK( log == "Clll" );
+    BOOST_CHECK( batch[0] == "hello world" );
+    BOOST_CHECK( batch[1] == "good bye" );
+    BOOST_CHECK( batch[2] == "goʹshen" );
+
+    auto columnar = taskit::make_TaskSequence(
+                                              taskit::make_TaskType<UpperCaseTypes>(),
+                                              taskit::make_TaskType<DropShortTexts>()
+                                             );
+
+    Columns columns{ { 'a', 'b' }, { "aa", "bbb" } };
+    columnar.runBatch(columns);
+
+    BOOST_CHECK( columns.type == std::vector<char>({ 'A', 'B' }) );
+    BOOST_CHECK( columns.text == std::vector<std::string>({ "", "bbb" }) );
+}
+
+struct Decoder
+{
+    int version;
+    std::vector<int> rules;
+
+    int operator()(int field) const
+    {
+        return rules.size() == static_cast<std::size_t>( version ) ? version * 100 + field : -1;
+    }
+};
+
+BOOST_AUTO_TEST_CASE( hot_swap_test )
+{
+    taskit::TaskSlot<Decoder> slot( Decoder{ 1, std::vector<int>( 1 ) } );
+
+    auto parser = taskit::make_Tasks<int>(
+                                    taskit::make_TaskType<int, 0>( slot.ref() ),
+                                    taskit::make_TaskType<int, 1>( [](int) { return 0; } ) );
+
+    BOOST_CHECK( parser.select( 0 )(7) == 107 );
+
+    slot.replace( Decoder{ 2, std::vector<int>( 2 ) } );
+    BOOST_CHECK( parser.select( 0 )(7) == 207 );
+
+    std::atomic<bool> done{ false };
+    std::atomic<int> failures{ 0 };
+    std::vector<std::thread> readers;
+    for( int i = 0; i < 4; ++i )
+    {
+        // Every reader works on its own Task copy, all of them sharing the slot
+        readers.emplace_back( [parser, &done, &failures]() mutable
+        {
+            while( !done.load() )
+            {
+                if( parser.select( 0 )(0) < 0 ) failures++;
+            }
+        } );
+    }
+
+    for( int version = 3; version < 200; ++version )
+    {
+        slot.replace( Decoder{ version, std::vector<int>( version ) } );
+    }
+    done = true;
+    for( auto& reader : readers ) reader.join();
+
+    BOOST_CHECK( failures == 0 );
+    BOOST_CHECK( parser.select( 0 )(7) == 19907 );
 }